@@ -1 +1 @@
-g++ -O3 -g -I. -o SIC.exe assembler.cpp stream.cpp utility.cpp SIC.cpp 
\ No newline at end of file
+g++ -O3 -g -pthread -I. -o SIC.exe analyzer.cpp assembler.cpp loader.cpp stream.cpp utility.cpp SIC.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+g++ -O3 -g -pthread -I. -o SICLoader.exe loader.cpp stream.cpp utility.cpp SICLoader.cpp
\ No newline at end of file
@@ -1,44 +1,141 @@
 #include<assembler.hpp>
+#include<loader.hpp>
 #include<fstream>
 #include<iostream>
 
 using namespace std;
 
+struct options {
+    bool relocatable;
+    bool delta;
+    SICAnalyzer* analyzer;
+};
+
+bool assemble(InputStream* input, fstream* intermediate, OutputStream* output_object, OutputStream* output_listing, options &opts, string source_path = "") {
+    SICAssembler assembler(input, output_object, intermediate, output_listing);
+    assembler.setSourcePath(source_path);
+    assembler.setRelocatable(opts.relocatable);
+    assembler.setAnalyzer(opts.analyzer);
+    cout << "Assembling..." << endl;
+    bool result = assembler.assemble();
+    cout << (result ? "Assembled successfully" : "Failed to assemble") << endl;
+    cout << "Error flag: " << assembler.getErrorFlag() << endl;
+    cout << "Literal bytes saved: " << assembler.getLiteralBytesSaved() << endl;
+    return result;
+}
+
+bool write_delta(SICLoader &previous, string output) {
+    // compare the new object program with the previous one and write the changes to output.dlt
+    SICLoader current;
+    if (!current.load_file(output + ".obj")) {
+        cout << "Can't read " << output << ".obj" << endl;
+        return false;
+    }
+    if (previous.getStartAddress() != current.getStartAddress()) {
+        // a delta can't move the program, so it holds the whole program instead
+        cout << "The start address changed, the delta holds the whole program" << endl;
+        previous = SICLoader();
+    }
+
+    FileOutputStream delta(output + ".dlt");
+    delta.write(SICLoader::make_delta(previous, current));
+    return true;
+}
+
 int main(int argc, char** argv) {
     InputStream* input;
     fstream* intermediate;
     OutputStream* output_object;
     OutputStream* output_listing;
+    options opts = {false, false, nullptr};
+    unordered_map<string, int> cost_model = SICAnalyzer::default_cost_model();
+    int loop_iterations = 10;
+    bool analyze = false;
+    int first = 1;
+
+    // options come before the file names
+    for (; first < argc && argv[first][0] == '-'; first++) {
+        string option = argv[first];
+        if (option == "-r") {
+            // relocatable object program with M records
+            opts.relocatable = true;
+        } else if (option == "-d") {
+            // delta against the object program of the previous build
+            opts.delta = true;
+        } else if (option == "-p") {
+            // estimated cycles and loops in the listing
+            analyze = true;
+        } else if (option == "-c" && first + 1 < argc) {
+            // cost model for -p
+            FileInputStream costs(argv[++first]);
+            analyze = true;
+            if (!costs.is_open() || !SICAnalyzer::load_cost_model(&costs, cost_model, loop_iterations)) {
+                cout << "Invalid cost model: " << argv[first] << endl;
+                return 1;
+            }
+        } else {
+            first = -1;
+            break;
+        }
+    }
+
+    if (analyze) opts.analyzer = new SICAnalyzer(cost_model, loop_iterations);
 
-    if (argc == 1) {
+    if (first == argc) {
         // Use stdin and stdout for input and output
         input = new ConsoleInputStream(cin);
         intermediate = new fstream("intermediate.int", ios_base::in | ios_base::out | ios_base::trunc);
         output_object = new ConsoleOutputStream(cout);
         output_listing = new ConsoleOutputStream(cout);
-    } else if(argc == 3) {
-        // Use argv[1] as input file and argv[2] as output file
-        input = new FileInputStream(argv[1]);
-        intermediate = new fstream(string(argv[2]) + ".int", ios_base::in | ios_base::out | ios_base::trunc);
-        output_object = new FileOutputStream(string(argv[2]) + ".obj");
-        output_listing = new FileOutputStream(string(argv[2]) + ".lst");
+
+        assemble(input, intermediate, output_object, output_listing, opts);
+
+        intermediate->close();
+        delete input;
+        delete intermediate;
+        delete output_object;
+        delete output_listing;
+    } else if(first > 0 && (argc - first) % 2 == 0) {
+        // Use argv[i] as input file and argv[i + 1] as output file
+        // included files are shared by all programs of the batch
+        for (int i = first; i < argc; i += 2) {
+            // read the previous build before its object file is overwritten
+            SICLoader previous;
+            if (opts.delta && !previous.load_file(string(argv[i + 1]) + ".obj")) {
+                // a missing or broken previous build gives a delta with the whole program
+                cout << "No previous " << argv[i + 1] << ".obj, the delta holds the whole program" << endl;
+                previous = SICLoader();
+            }
+
+            input = new FileInputStream(argv[i]);
+            intermediate = new fstream(string(argv[i + 1]) + ".int", ios_base::in | ios_base::out | ios_base::trunc);
+            output_object = new FileOutputStream(string(argv[i + 1]) + ".obj");
+            output_listing = new FileOutputStream(string(argv[i + 1]) + ".lst");
+
+            cout << argv[i] << endl;
+            bool result = assemble(input, intermediate, output_object, output_listing, opts, argv[i]);
+
+            intermediate->close();
+            delete input;
+            delete intermediate;
+            delete output_object;
+            delete output_listing;
+
+            if (result && opts.delta) write_delta(previous, argv[i + 1]);
+        }
     } else {
-        cout << "Usage: " << argv[0] << " [input file] [output file]" << endl;
+        cout << "Usage: " << argv[0] << " [-r] [-d] [-p] [-c cost file] [input file] [output file] [input file] [output file] ..." << endl;
+        cout << "  -r  relocatable object program" << endl;
+        cout << "  -d  also write the changes against the previous output file.obj to output file.dlt" << endl;
+        cout << "  -p  annotate the listing with estimated cycles and loops" << endl;
+        cout << "  -c  read the cycles per mnemonic for -p from a file" << endl;
+        delete opts.analyzer;
         return 1;
     }
 
-    SICAssembler assembler(input, output_object, intermediate, output_listing);
-    cout << "Assembling..." << endl;
-    cout << (assembler.assemble() ? "Assembled successfully" : "Failed to assemble") << endl;
-    cout << "Error flag: " << assembler.getErrorFlag() << endl;
-
-    intermediate->close();
-    delete input;
-    delete intermediate;
-    delete output_object;
-    delete output_listing;
+    delete opts.analyzer;
 
     cout << "Exiting..." << endl;
-        
+
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,95 @@
+#include<loader.hpp>
+#include<chrono>
+#include<iostream>
+
+using namespace std;
+
+int benchmark(vector<string> &filenames, int threads, int repeat) {
+    // decode every file 'repeat' times and report the throughput over the object file bytes
+    vector<SICLoader> loaders;
+    size_t bytes = 0;
+    int loaded = 0;
+
+    for (string &filename : filenames) {
+        MappedFile file(filename);
+        if (!file.is_open()) {
+            cout << "Can't open " << filename << endl;
+            return 1;
+        }
+        bytes += file.getSize();
+    }
+
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < repeat; i++) {
+        loaded += SICLoader::load_files(filenames, loaders, threads);
+    }
+    chrono::duration<double> seconds = chrono::steady_clock::now() - begin;
+
+    cout << "Loaded " << loaded << " of " << filenames.size() * repeat << " object programs with " << threads << " thread(s)" << endl;
+    cout << "Object bytes: " << bytes * repeat << ", time: " << seconds.count() << " s" << endl;
+    cout << "Throughput: " << (seconds.count() > 0 ? bytes * repeat / seconds.count() / 1e6 : 0) << " MB/s" << endl;
+    return loaded == (int)filenames.size() * repeat ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    OutputStream* output;
+    SICLoader loader;
+    vector<string> filenames;
+    string patch = "";
+    int load_address = -1, threads = 1, repeat = 1, i = 1;
+    bool binary = false, bench = false, usage = false;
+
+    // options come before the file names
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        string option = argv[i];
+        if (option == "-b") {
+            binary = true;
+        } else if (option == "-t") {
+            bench = true;
+        } else if (option == "-p" && i + 1 < argc) {
+            patch = argv[++i];
+        } else if (option == "-a" && i + 1 < argc) {
+            load_address = stoi(string(argv[++i]), 16);
+            usage |= load_address < 0;
+        } else if (option == "-j" && i + 1 < argc) {
+            threads = stoi(string(argv[++i]), 10);
+            usage |= threads < 1;
+        } else if (option == "-n" && i + 1 < argc) {
+            repeat = stoi(string(argv[++i]), 10);
+            usage |= repeat < 1;
+        } else {
+            usage = true;
+        }
+    }
+    for (; i < argc; i++) filenames.push_back(argv[i]);
+
+    if (usage || filenames.size() == 0 || (!bench && filenames.size() > 2)) {
+        cout << "Usage: " << argv[0] << " [-b] [-p delta file] [-a load address] <object file> [output file]" << endl;
+        cout << "       " << argv[0] << " -t [-j threads] [-n repeat] <object file> ..." << endl;
+        cout << "  -b  write a raw binary image instead of a hex dump" << endl;
+        cout << "  -p  apply a delta written by SIC -d to the object program" << endl;
+        cout << "  -a  relocate the program to the given hex address" << endl;
+        cout << "  -t  benchmark decoding of the object files" << endl;
+        return 1;
+    }
+
+    if (bench) return benchmark(filenames, threads, repeat);
+
+    if (loader.load_file(filenames[0]) && (patch == "" || loader.apply_file(patch))
+        && (load_address < 0 || loader.relocate(load_address))) {
+        if (filenames.size() == 2) output = new FileOutputStream(filenames[1], binary);
+        else output = new ConsoleOutputStream(cout);
+
+        if (binary) loader.write_binary(output);
+        else loader.write_hex_dump(output);
+        delete output;
+
+        cout << "Loaded " << loader.getProgramName() << " at " << itos(loader.getLoadAddress(), 16)
+             << ", execution starts at " << itos(loader.getExecutionAddress(), 16) << endl;
+    } else {
+        cout << "Failed to load" << endl;
+    }
+    cout << "Error flag: " << loader.getErrorFlag() << endl;
+
+    return loader.getErrorFlag() ? 1 : 0;
+}
@@ -0,0 +1,216 @@
+#include "analyzer.hpp"
+#include<assembler.hpp>
+#include<algorithm>
+#include<sstream>
+
+SICAnalyzer::SICAnalyzer(unordered_map<string, int> cost_model, int loop_iterations) {
+    this->cost_model = cost_model;
+    this->loop_iterations = loop_iterations;
+    this->total_cycles = 0;
+}
+
+unordered_map<string, int> SICAnalyzer::default_cost_model() {
+    // rough cycles per instruction of the assembler's opcode table: one for the fetch and one for
+    // the memory operand, except for jumps, multiplication, division and device I/O
+    static const unordered_map<string, int> exceptions = {
+        {"DIV", 6}, {"J", 1}, {"JEQ", 1}, {"JGT", 1}, {"JLT", 1}, {"MUL", 4}, {"RD", 10}, {"TD", 10}, {"WD", 10}
+    };
+    unordered_map<string, int> result;
+
+    for(auto &opcode : SICAssembler::getOpcodeTable()) {
+        auto exception = exceptions.find(opcode.first);
+        result[opcode.first] = (exception == exceptions.end() ? 2 : exception->second);
+    }
+    return result;
+}
+
+bool SICAnalyzer::load_cost_model(InputStream *input, unordered_map<string, int> &cost_model, int &loop_iterations) {
+    // each line is a mnemonic and its cycles, or ITERATIONS and the assumed iterations per loop
+    // lines starting with '.' are comments
+    string line, key;
+    int value;
+
+    while(!input->eof() && !input->fail()) {
+        line = input->readline();
+        if(line == "" || line[0] == '.') continue;
+
+        istringstream fields(line);
+        if(!(fields >> key >> value) || value < 0) return false;
+        key = upper(key);
+        if(key == "ITERATIONS") {
+            if(value < 1) return false;
+            loop_iterations = value;
+        } else if(cost_model.find(key) != cost_model.end()) {
+            cost_model[key] = value;
+        } else { // unknown mnemonic
+            return false;
+        }
+    }
+    return true;
+}
+
+vector<vector<int>> SICAnalyzer::successors(vector<int> &roots) const {
+    // edges of the control flow graph between lines, and the lines control can start at
+    // a subroutine called by JSUB is a root, the call itself falls through
+    vector<vector<int>> result(this->lines.size());
+    int next;
+
+    if(!this->lines.empty()) roots.push_back(0);
+    for(size_t i = 0; i < this->lines.size(); i++) {
+        const code_line &line = this->lines[i];
+        auto target = this->line_index.find(line.target);
+        bool jump = line.opcode == "J" || line.opcode == "JEQ" || line.opcode == "JGT" || line.opcode == "JLT";
+
+        if(jump && target != this->line_index.end()) result[i].push_back(target->second);
+        if(line.opcode == "JSUB" && target != this->line_index.end()) roots.push_back(target->second);
+
+        next = i + 1;
+        if(line.opcode != "J" && line.opcode != "RSUB" && next < (int)this->lines.size()
+            && this->lines[next].address == line.address + 3) {
+            result[i].push_back(next);
+        }
+    }
+    return result;
+}
+
+void SICAnalyzer::analyze(vector<code_line> &lines) {
+    // find loops as the natural loops of the back edges of a depth-first search
+    // a line is assumed to run loop_iterations times for every loop around it
+    vector<int> roots, state, depth;
+    vector<vector<int>> next, previous;
+    vector<pair<int, int>> back_edges;
+    vector<vector<char>> in_loop;
+    unordered_map<int, int> loop_of_header;
+    vector<pair<int, size_t>> stack;
+    vector<int> work;
+
+    this->lines = lines;
+    this->loops.clear();
+    this->line_index.clear();
+    for(size_t i = 0; i < lines.size(); i++) this->line_index[lines[i].address] = i;
+
+    int n = lines.size();
+    next = this->successors(roots);
+    previous.assign(n, vector<int>());
+    for(int i = 0; i < n; i++) {
+        for(int j : next[i]) previous[j].push_back(i);
+    }
+    for(int i = 0; i < n; i++) roots.push_back(i); // unreachable code is searched last
+
+    // 0: not visited, 1: on the search path, 2: done
+    state.assign(n, 0);
+    for(int root : roots) {
+        if(state[root] != 0) continue;
+        state[root] = 1;
+        stack.push_back({root, 0});
+        while(!stack.empty()) {
+            int u = stack.back().first;
+            if(stack.back().second < next[u].size()) {
+                int v = next[u][stack.back().second++];
+                if(state[v] == 0) {
+                    state[v] = 1;
+                    stack.push_back({v, 0});
+                } else if(state[v] == 1) {
+                    back_edges.push_back({u, v});
+                }
+            } else {
+                state[u] = 2;
+                stack.pop_back();
+            }
+        }
+    }
+
+    // a loop is everything that reaches the back edge without passing its header
+    for(pair<int, int> &edge : back_edges) {
+        int header = edge.second;
+        if(loop_of_header.find(header) == loop_of_header.end()) {
+            loop_of_header[header] = this->loops.size();
+            this->loops.push_back({header, {header}, 0, 0});
+            in_loop.push_back(vector<char>(n, 0));
+            in_loop.back()[header] = 1;
+        }
+        int l = loop_of_header[header];
+        work.assign(1, edge.first);
+        while(!work.empty()) {
+            int u = work.back();
+            work.pop_back();
+            if(in_loop[l][u]) continue;
+            in_loop[l][u] = 1;
+            this->loops[l].body.push_back(u);
+            for(int p : previous[u]) work.push_back(p);
+        }
+    }
+
+    depth.assign(n, 0);
+    for(loop &l : this->loops) {
+        for(int i : l.body) depth[i]++;
+    }
+
+    this->line_cycles.assign(n, 0);
+    this->total_cycles = 0;
+    for(int i = 0; i < n; i++) {
+        auto cost = this->cost_model.find(lines[i].opcode);
+        long long cycles = (cost == this->cost_model.end() ? 0 : cost->second);
+        for(int d = 0; d < depth[i] && cycles < (1LL << 50); d++) cycles *= this->loop_iterations;
+        this->line_cycles[i] = cycles;
+        this->total_cycles += cycles;
+    }
+
+    for(loop &l : this->loops) {
+        l.depth = depth[l.header];
+        for(int i : l.body) l.cycles += this->line_cycles[i];
+        sort(l.body.begin(), l.body.end());
+    }
+    sort(this->loops.begin(), this->loops.end(), [](const loop &a, const loop &b) {
+        return a.cycles > b.cycles || (a.cycles == b.cycles && a.header < b.header);
+    });
+
+    // the innermost loop of a line is the smallest one around it
+    this->line_loop.assign(n, -1);
+    for(size_t l = 0; l < this->loops.size(); l++) {
+        for(int i : this->loops[l].body) {
+            int current = this->line_loop[i];
+            if(current < 0 || this->loops[l].body.size() < this->loops[current].body.size()) this->line_loop[i] = l;
+        }
+    }
+}
+
+bool SICAnalyzer::is_hot(const loop &l) const {
+    // hot loops are the ones that take a large share of the estimated cycles, however many there are
+    return this->total_cycles > 0 && l.cycles * 100 >= this->total_cycles * hot_percent;
+}
+
+string SICAnalyzer::annotate(int address) const {
+    // estimated cycles of the line, its innermost loop, and HOT inside a hot loop
+    auto it = this->line_index.find(address);
+    if(it == this->line_index.end()) return "";
+
+    int i = it->second, l = this->line_loop[i];
+    string result = align_right(to_string(this->line_cycles[i]), 10, ' ');
+    if(l >= 0) result += " L" + to_string(l + 1);
+    // loops are sorted hottest first
+    for(size_t hot = 0; hot < this->loops.size() && this->is_hot(this->loops[hot]); hot++) {
+        if(binary_search(this->loops[hot].body.begin(), this->loops[hot].body.end(), i)) {
+            result += " HOT";
+            break;
+        }
+    }
+    return result;
+}
+
+void SICAnalyzer::write_report(OutputStream *output) const {
+    output->write(".\n");
+    output->write(".Estimated cycles, assuming " + to_string(this->loop_iterations) + " iterations per loop\n");
+    output->write("." + align_right("loop", 9, ' ') + '\t' + align_right("header", 10, ' ') + '\t' + align_right("end", 10, ' ')
+        + '\t' + align_right("depth", 10, ' ') + '\t' + align_right("cycles", 10, ' ') + '\n');
+    for(size_t l = 0; l < this->loops.size(); l++) {
+        const loop &current = this->loops[l];
+        output->write("." + align_right("L" + to_string(l + 1), 9, ' ')
+            + '\t' + align_right(itos(this->lines[current.header].address, 16), 10, ' ')
+            + '\t' + align_right(itos(this->lines[current.body.back()].address, 16), 10, ' ')
+            + '\t' + align_right(to_string(current.depth), 10, ' ')
+            + '\t' + align_right(to_string(current.cycles), 10, ' ')
+            + (this->is_hot(current) ? " HOT" : "") + '\n');
+    }
+    output->write(".Total estimated cycles: " + to_string(this->total_cycles) + '\n');
+}
@@ -0,0 +1,49 @@
+#ifndef ANALYZER_HPP
+#define ANALYZER_HPP
+
+#include<stream.hpp>
+#include<utility.hpp>
+#include<unordered_map>
+
+using namespace std;
+
+class SICAnalyzer {
+    public:
+        struct code_line {
+            int address;
+            string opcode;
+            int target;     // address a jump goes to, -1 if unknown or not a jump
+        };
+
+    private:
+        struct loop {
+            int header;                 // index of the first line of the loop
+            vector<int> body;           // indices of the lines in the loop
+            int depth;                  // 1 for an outermost loop
+            long long cycles;           // estimated cycles of all its lines
+        };
+
+        unordered_map<string, int> cost_model;
+        int loop_iterations;            // assumed iterations of every loop
+        vector<code_line> lines;
+        vector<long long> line_cycles;
+        vector<int> line_loop;          // innermost loop of every line, -1 if none
+        unordered_map<int, int> line_index; // address to index in 'lines'
+        vector<loop> loops;             // hottest first
+        long long total_cycles;         // estimated cycles of the whole program
+
+        vector<vector<int>> successors(vector<int> &roots) const;
+        bool is_hot(const loop &l) const;
+
+    public:
+        SICAnalyzer(unordered_map<string, int> cost_model = default_cost_model(), int loop_iterations = 10);
+        void analyze(vector<code_line> &lines);
+        string annotate(int address) const;
+        void write_report(OutputStream* output) const;
+
+        static const int hot_percent = 25;     // a loop is hot if it takes this share of all cycles
+        static unordered_map<string, int> default_cost_model();
+        static bool load_cost_model(InputStream* input, unordered_map<string, int> &cost_model, int &loop_iterations);
+};
+
+#endif
@@ -11,16 +11,30 @@ const unordered_map<string, set<unsigned char>> SICAssembler::format_table = {
     {"ADD", {1}}, {"AND", {1}}, {"COMP", {1}}, {"DIV", {1}}, {"J", {1}}, {"JEQ", {1}}, {"JGT", {1}}, {"JLT", {1}}, {"JSUB", {1}}, {"LDA", {1}}, {"LDCH", {1}}, {"LDL", {1}}, {"LDX", {1}}, {"MUL", {1}}, {"OR", {1}}, {"RD", {1}}, {"RSUB", {0}}, {"STA", {1}}, {"STCH", {1}}, {"STL", {1}}, {"STSW", {0}}, {"STX", {1}}, {"SUB", {1}}, {"TD", {1}}, {"TIX", {1}}, {"WD", {1}}
 };
 
+const set<string> SICAssembler::directive_table = {
+    "START", "END", "LTORG", "INCLUDE", "MACRO", "MEND", "EQU", "ORG"
+};
+
+// included files are tokenized once per process and shared by every assembler
+unordered_map<string, SICAssembler::cached_source> SICAssembler::source_cache;
+mutex SICAssembler::source_cache_mutex;
+
 SICAssembler::instruction SICAssembler::process_instruction(int &locctr, string &label, string &opcode, string &operand) {
     instruction _i;
+    int value;
+    bool relative, resolved;
     _i.label = label;
     _i.opcode = opcode;
     _i.operand = operand;
     _i.address = locctr;
     _i.length = 0;
 
-    if(label != "") {
-        if(this->symbol_table.find(label) != this->symbol_table.end()) {
+    if(locctr > this->max_locctr) this->max_locctr = locctr;
+
+    // an EQU label gets the value of its expression instead
+    if(label != "" && opcode != "EQU") {
+        if(this->symbol_table.find(label) != this->symbol_table.end()
+            || this->pending_equate_index.find(label) != this->pending_equate_index.end()) {
             // duplicate symbol
             this->error_flag |= 4;
         } else {
@@ -30,46 +44,281 @@ SICAssembler::instruction SICAssembler::process_instruction(int &locctr, string
 
     if(opcode == "WORD") {
         _i.length = 3;
-    } else if(opcode == "RESW") {
-        _i.length = 3 * stoi(operand, 10);
-    } else if(opcode == "RESB") {
-        _i.length = stoi(operand);
+    } else if(opcode == "RESW" || opcode == "RESB") {
+        // the size must be known in pass1
+        if(this->evaluate(operand, operand.length(), locctr, value, relative, resolved) && resolved && !relative && value >= 0) {
+            _i.length = (opcode == "RESW" ? 3 * value : value);
+        } else {
+            // invalid operand
+            this->error_flag |= 8;
+        }
     } else if(opcode == "BYTE") {
         if(toupper(operand[0]) == 'C') {
             _i.length = operand.length() - 3;
         } else if(toupper(operand[0]) == 'X') {
             _i.length = (operand.length() - 3) / 2;
+            if((operand.length() - 3) % 2 != 0) {
+                // odd number of hex digits
+                this->error_flag |= 8;
+            }
         } else {
             // invalid operand
             this->error_flag |= 8;
         }
     } else if(opcode_table.find(opcode) != opcode_table.end()) {
         _i.length = 3;
+        if(operand[0] == '=' && !this->register_literal(operand)) {
+            // invalid literal
+            this->error_flag |= 8;
+        }
+    } else if(opcode == "EQU") {
+        if(label == "") {
+            // invalid operand
+            this->error_flag |= 8;
+        } else if(this->symbol_table.find(label) != this->symbol_table.end()
+            || this->pending_equate_index.find(label) != this->pending_equate_index.end()) {
+            // duplicate symbol
+            this->error_flag |= 4;
+        } else {
+            this->define_equate(label, operand, locctr);
+        }
+    } else if(opcode == "ORG") {
+        // without an operand, continue after the highest address used so far
+        if(operand == "") {
+            locctr = this->max_locctr;
+        } else if(this->evaluate(operand, operand.length(), locctr, value, relative, resolved) && resolved && value >= 0) {
+            locctr = value;
+        } else {
+            // invalid operand
+            this->error_flag |= 8;
+        }
+    } else if(opcode == "LTORG") {
+        // the pool itself is written by pass1 right after this line
+    } else if(opcode == "INCLUDE") {
+        // the included lines are read by pass1 right after this line
     } else if(opcode == "START") {
-        this->start_address = locctr = _i.address = stoi(operand, 16);
+        this->start_address = this->max_locctr = locctr = _i.address = stoi(operand, 16);
+        if(label != "") this->symbol_table[label] = locctr;
     } else if(opcode == "END") {
-        this->program_length = locctr - this->start_address;
+        this->program_length = this->max_locctr - this->start_address;
     } else {
         // invalid opcode
         this->error_flag |= 16;
     }
 
+    if(_i.length > 0 && opcode != "RESW" && opcode != "RESB" && !this->claim_object_code(locctr, _i.length)) {
+        // object code over bytes that already have some, ORG moved back too far
+        log("object code overlaps at " + itos(locctr, 16));
+        this->error_flag |= 8;
+    }
+
     locctr += _i.length;
+    if(locctr > this->max_locctr) this->max_locctr = locctr;
 
     return _i;
 }
 
+bool SICAssembler::claim_object_code(int address, int length) {
+    // ORG may move back over reserved bytes, but the loader rejects T records that overlap
+    // adjacent ranges are merged, so code written in order keeps a single one
+    int end = address + length;
+    auto next = this->object_ranges.upper_bound(address);
+    if(next != this->object_ranges.end() && next->first < end) return false;
+
+    auto range = next;
+    if(range != this->object_ranges.begin() && prev(range)->second >= address) {
+        range = prev(range);
+        if(range->second > address) return false;
+        range->second = end;
+    } else {
+        range = this->object_ranges.insert(next, {address, end});
+    }
+    if(next != this->object_ranges.end() && next->first == end) {
+        range->second = next->second;
+        this->object_ranges.erase(next);
+    }
+    return true;
+}
+
+void SICAssembler::define_equate(string &label, string &operand, int locctr) {
+    // an expression with symbols that aren't defined yet waits for resolve_equates()
+    int value;
+    bool relative, resolved;
+    vector<string> unresolved;
+
+    if(!this->evaluate(operand, operand.length(), locctr, value, relative, resolved, &unresolved)) {
+        // invalid operand
+        this->error_flag |= 8;
+    } else if(resolved) {
+        this->symbol_table[label] = value;
+        if(!relative) this->absolute_symbols.insert(label);
+    } else {
+        this->pending_equate_index[label] = this->pending_equates.size();
+        this->pending_equates.push_back({label, operand, locctr, unresolved});
+    }
+}
+
+bool SICAssembler::resolve_equates() {
+    // resolve the waiting equates in one topological pass over their dependency graph
+    // whatever remains afterwards depends on itself
+    unordered_map<string, vector<size_t>> dependents;
+    vector<int> waiting(this->pending_equates.size(), 0);
+    vector<size_t> ready;
+    int value;
+    bool relative, resolved;
+
+    for(size_t i = 0; i < this->pending_equates.size(); i++) {
+        for(string &symbol : this->pending_equates[i].dependencies) {
+            if(this->symbol_table.find(symbol) != this->symbol_table.end()) continue;
+            if(this->pending_equate_index.find(symbol) == this->pending_equate_index.end()) {
+                // undefined symbol
+                log("can't find symbol: " + symbol);
+                this->error_flag |= 4;
+                return false;
+            }
+            dependents[symbol].push_back(i);
+            waiting[i]++;
+        }
+        if(waiting[i] == 0) ready.push_back(i);
+    }
+
+    for(size_t next = 0; next < ready.size(); next++) {
+        equate &e = this->pending_equates[ready[next]];
+        if(!this->evaluate(e.operand, e.operand.length(), e.locctr, value, relative, resolved) || !resolved) {
+            // invalid operand
+            this->error_flag |= 8;
+            return false;
+        }
+        this->symbol_table[e.label] = value;
+        if(!relative) this->absolute_symbols.insert(e.label);
+
+        for(size_t dependent : dependents[e.label]) {
+            if(--waiting[dependent] == 0) ready.push_back(dependent);
+        }
+    }
+
+    if(ready.size() != this->pending_equates.size()) {
+        // circular definition
+        this->error_flag |= 512;
+        return false;
+    }
+    this->pending_equates.clear();
+    this->pending_equate_index.clear();
+    return true;
+}
+
+bool SICAssembler::evaluate(const string &expression, size_t length, int locctr, int &value, bool &relative, bool &resolved, vector<string> *unresolved) {
+    // evaluate the first 'length' characters of 'expression': terms joined by '+' and '-',
+    // each a decimal number, a symbol or '*' for the location counter
+    // return false if the expression is invalid, 'resolved' is false if a symbol isn't defined yet
+    int sign = 1, relative_terms = 0, term;
+    bool expect_term = true;
+    size_t i = 0, j;
+
+    value = 0;
+    relative = false;
+    resolved = true;
+    if(length == 0) return false;
+
+    while(i < length) {
+        char c = expression[i];
+        if(expect_term) {
+            if(c == '+' || c == '-') { // sign of the term
+                if(c == '-') sign = -sign;
+                i++;
+                continue;
+            } else if(isdigit(c)) {
+                for(term = 0; i < length && isdigit(expression[i]); i++) term = term * 10 + expression[i] - '0';
+                value += sign * term;
+            } else if(c == '*') {
+                value += sign * locctr;
+                relative_terms += sign;
+                i++;
+            } else if(isalpha(c)) {
+                for(j = i; j < length && (isalnum(expression[j]) || expression[j] == '_'); j++);
+                this->symbol_buffer.assign(expression, i, j - i);
+                auto it = this->symbol_table.find(this->symbol_buffer);
+                if(it != this->symbol_table.end()) {
+                    value += sign * it->second;
+                    if(this->absolute_symbols.find(this->symbol_buffer) == this->absolute_symbols.end()) relative_terms += sign;
+                } else {
+                    resolved = false;
+                    if(unresolved != nullptr) unresolved->push_back(this->symbol_buffer);
+                }
+                i = j;
+            } else return false;
+            expect_term = false;
+            sign = 1;
+        } else {
+            if(c == '+') sign = 1;
+            else if(c == '-') sign = -1;
+            else return false;
+            expect_term = true;
+            i++;
+        }
+    }
+    if(expect_term) return false;
+
+    // the result is either absolute or relative to the program
+    if(resolved && relative_terms != 0 && relative_terms != 1) return false;
+    relative = (relative_terms == 1);
+    return true;
+}
+
 void SICAssembler::write_intermediate_line(int &line_number, instruction &processed_instruction) const {
     // every element must align to 10 characters
     string element, line = "";
     line += align_right(to_string(line_number * 5), 10, ' ') + "\t";
-    line += align_right((processed_instruction.opcode == "END" ? "" : itos(processed_instruction.address, 16)), 10, ' ') + "\t";
+    // an EQU line has no address, its value may only be known at the end of pass1
+    line += align_right((processed_instruction.opcode == "END" || processed_instruction.opcode == "EQU" ? "" : itos(processed_instruction.address, 16)), 10, ' ') + "\t";
     line += align_right(processed_instruction.label, 10, ' ') + "\t";
     line += align_right(processed_instruction.opcode, 10, ' ') + "\t";
     line += align_right(processed_instruction.operand, 10, ' ') + "\n";
     this->intermediate->write(line.c_str(), line.length());
 }
 
+bool SICAssembler::register_literal(string &operand) {
+    string value, tmp_s = operand;
+    int length;
+
+    if(tmp_s.length() > 2 && tmp_s[tmp_s.length() - 2] == ',' && tmp_s[tmp_s.length() - 1] == 'X') {
+        tmp_s = tmp_s.substr(0, tmp_s.length() - 2);
+    }
+    if(!parse_literal(tmp_s.substr(1), value, length)) return false;
+
+    // literals with the same value share one pool entry, whatever form they were written in
+    auto it = this->literal_table.find(value);
+    if(it != this->literal_table.end()) {
+        this->literal_bytes_saved += it->second.length;
+    } else {
+        this->literal_table[value] = {tmp_s.substr(1), -1, length};
+        this->literal_pool.push_back(value);
+    }
+    return true;
+}
+
+void SICAssembler::write_literal_pool(int &locctr) {
+    // pool lines have no source line number, pass2 reads them as plain BYTE/WORD lines
+    string line;
+    for(string &value : this->literal_pool) {
+        literal &lit = this->literal_table[value];
+        lit.address = locctr;
+        if(!this->claim_object_code(locctr, lit.length)) {
+            // the pool lands on bytes that already have object code
+            log("object code overlaps at " + itos(locctr, 16));
+            this->error_flag |= 8;
+        }
+        line = string(10, ' ') + "\t";
+        line += align_right(itos(locctr, 16), 10, ' ') + "\t";
+        line += align_right("*", 10, ' ') + "\t";
+        line += align_right((isdigit(lit.operand[0]) || lit.operand[0] == '-' ? "WORD" : "BYTE"), 10, ' ') + "\t";
+        line += align_right(lit.operand, 10, ' ') + "\n";
+        this->intermediate->write(line.c_str(), line.length());
+        locctr += lit.length;
+    }
+    this->literal_pool.clear();
+}
+
 void SICAssembler::write_comment(int &line_number, string &comment) const {
     string element, line = "";
     element = to_string(line_number * 5);
@@ -84,12 +333,15 @@ SICAssembler::SICAssembler(InputStream *input, OutputStream *output_object, fstr
     this->intermediate = intermediate;
     intermediate->seekp(0, ios_base::beg);
     this->output_listing = output_listing;
+    this->relocatable = false;
+    this->analyzer = nullptr;
+    this->source_path = "";
 }
 
 OutputStream* SICAssembler::fake_output_stream = new NoneOutputStream();
 
 bool SICAssembler::pass1() {
-    string line, opcode, operand, label;
+    source_line line;
     instruction processed_instruction;
     int locctr, line_number = 0;
     bool first_line = true;
@@ -99,28 +351,40 @@ bool SICAssembler::pass1() {
     this->program_length = 0;
     this->error_flag = 0;
     this->symbol_table = unordered_map<string, int>();
+    this->absolute_symbols = unordered_set<string>();
+    this->pending_equates.clear();
+    this->pending_equate_index = unordered_map<string, size_t>();
+    this->max_locctr = 0;
+    this->object_ranges.clear();
+    this->literal_table = unordered_map<string, literal>();
+    this->literal_pool.clear();
+    this->literal_bytes_saved = 0;
+    this->source_stack.clear();
+    this->instruction_stream.clear();
+    this->macro_table = unordered_map<string, macro_definition>();
+    this->expansion_cache = unordered_map<string, shared_ptr<const vector<source_line>>>();
     while(true) {
-        if(input->eof()) { // empty file
+        if(!this->next_source_line(line)) { // empty file
             this->error_flag |= 1;
             return false;
         }
-        line = input->readline();
 
-        if(!this->input_is_comment(line)) break;
-        else {
+        if(line.comment) {
             line_number++;
-            this->write_comment(line_number, line);
-        }
+            this->write_comment(line_number, line.text);
+        } else if(line.valid && line.opcode == "MACRO") { // macros may be defined before START
+            if(!this->define_macro(line, line_number)) return false;
+        } else break;
     }
 
-    if(parse_input_line(line, label, opcode, operand)){
-        if(opcode == "START"){
+    if(line.valid){
+        if(line.opcode == "START"){
             first_line = false;
-            processed_instruction = this->process_instruction(locctr, label, opcode, operand);
+            processed_instruction = this->process_instruction(locctr, line.label, line.opcode, line.operand);
             if(this->error_flag) return false;
             line_number++;
             this->write_intermediate_line(line_number, processed_instruction);
-        } else if(opcode == "END") { // empty program
+        } else if(line.opcode == "END") { // empty program
             this->error_flag |= 1;
             return false;
         } else {
@@ -131,28 +395,20 @@ bool SICAssembler::pass1() {
         return false;
     }
 
-    if(first_line) {
-        processed_instruction = this->process_instruction(locctr, label, opcode, operand);
-        if(this->error_flag) return false;
-        line_number++;
-        this->write_intermediate_line(line_number, processed_instruction);
-    }
+    if(first_line && !this->process_source_line(line, locctr, line_number)) return false;
 
-    while(!input->eof()) {
-        line = input->readline();
-        if(!this->input_is_comment(line)) {
-            if(parse_input_line(line, label, opcode, operand)){
-                if(opcode == "END"){
-                    processed_instruction = this->process_instruction(locctr, label, opcode, operand);
-                    if(this->error_flag) return false;
-                    line_number++;
-                    this->write_intermediate_line(line_number, processed_instruction);
-                    return true;
-                } else {
-                    processed_instruction = this->process_instruction(locctr, label, opcode, operand);
+    while(this->next_source_line(line)) {
+        if(!line.comment) {
+            if(line.valid){
+                if(line.opcode == "END"){
+                    this->write_literal_pool(locctr);
+                    processed_instruction = this->process_instruction(locctr, line.label, line.opcode, line.operand);
                     if(this->error_flag) return false;
                     line_number++;
                     this->write_intermediate_line(line_number, processed_instruction);
+                    return this->resolve_equates();
+                } else if(!this->process_source_line(line, locctr, line_number)) {
+                    return false;
                 }
             } else { // invalid line
                 this->error_flag |= 2;
@@ -160,7 +416,7 @@ bool SICAssembler::pass1() {
             }
         } else {
             line_number++;
-            this->write_comment(line_number, line);
+            this->write_comment(line_number, line.text);
         }
     }
 
@@ -169,16 +425,223 @@ bool SICAssembler::pass1() {
     return false;
 }
 
+bool SICAssembler::process_source_line(source_line &line, int &locctr, int &line_number) {
+    // handle a line of pass1 other than START and END
+    instruction processed_instruction;
+
+    // 'LABEL NAME' invoking a macro without arguments is parsed as opcode and operand
+    // a line starting with a mnemonic or directive stays one, even if its operand names a macro
+    if(line.label == "" && this->macro_table.find(line.opcode) == this->macro_table.end()
+        && opcode_table.find(line.opcode) == opcode_table.end() && directive_table.find(line.opcode) == directive_table.end()
+        && this->macro_table.find(upper(line.operand)) != this->macro_table.end()) {
+        line.label = line.text.substr(line.text.find_first_not_of(" \t"), line.opcode.length());
+        line.opcode = upper(line.operand);
+        line.operand = "";
+    }
+
+    if(line.opcode == "MACRO") {
+        return this->define_macro(line, line_number);
+    } else if(this->macro_table.find(line.opcode) != this->macro_table.end()) {
+        // the invocation is listed as a comment, followed by its expansion
+        string comment = "." + line.text;
+        line_number++;
+        this->write_comment(line_number, comment);
+        return this->expand_macro(line, locctr);
+    }
+
+    processed_instruction = this->process_instruction(locctr, line.label, line.opcode, line.operand);
+    if(this->error_flag) return false;
+    line_number++;
+    this->write_intermediate_line(line_number, processed_instruction);
+    if(this->analyzer != nullptr && opcode_table.find(line.opcode) != opcode_table.end()) {
+        this->instruction_stream.push_back(processed_instruction);
+    }
+    if(line.opcode == "LTORG") this->write_literal_pool(locctr);
+    else if(line.opcode == "INCLUDE") return this->include_source(line.operand);
+    return true;
+}
+
+bool SICAssembler::define_macro(source_line &line, int &line_number) {
+    // store the lines up to the matching MEND as they were tokenized
+    // the definition is listed as comments
+    macro_definition definition;
+    string name = upper(line.label), comment;
+    int depth = 0;
+
+    if(name == "" || this->macro_table.find(name) != this->macro_table.end()) { // missing or duplicate macro name
+        this->error_flag |= 256;
+        return false;
+    }
+    if(line.operand != "") definition.parameters = split_arguments(line.operand);
+    for(string &parameter : definition.parameters) {
+        if(parameter.length() < 2 || parameter[0] != '&') { // invalid parameter
+            this->error_flag |= 256;
+            return false;
+        }
+    }
+    comment = "." + line.text;
+    line_number++;
+    this->write_comment(line_number, comment);
+
+    while(this->next_source_line(line)) {
+        comment = (line.comment && line.text[0] == '.' ? line.text : "." + line.text);
+        line_number++;
+        this->write_comment(line_number, comment);
+
+        if(!line.comment && !line.valid) { // invalid line
+            this->error_flag |= 2;
+            return false;
+        }
+        if(!line.comment && line.opcode == "MACRO") depth++;
+        else if(!line.comment && line.opcode == "MEND") {
+            if(depth == 0) {
+                this->macro_table[name] = definition;
+                return true;
+            }
+            depth--;
+        }
+        definition.body.push_back(line);
+    }
+
+    // no MEND statement
+    this->error_flag |= 256;
+    return false;
+}
+
+bool SICAssembler::expand_macro(source_line &line, int &locctr) {
+    // expansions are memoized per argument list, the expanded lines go straight to pass1
+    macro_definition &definition = this->macro_table[line.opcode];
+    string key = line.opcode + '\t' + line.operand;
+    shared_ptr<const vector<source_line>> lines;
+
+    if(this->source_stack.size() >= max_include_depth) { // recursive macro
+        this->error_flag |= 256;
+        return false;
+    }
+
+    if(line.label != "") {
+        if(this->symbol_table.find(line.label) != this->symbol_table.end()) {
+            // duplicate symbol
+            this->error_flag |= 4;
+            return false;
+        }
+        this->symbol_table[line.label] = locctr;
+    }
+
+    auto it = this->expansion_cache.find(key);
+    if(it != this->expansion_cache.end()) {
+        lines = it->second;
+    } else {
+        vector<string> arguments;
+        if(line.operand != "") arguments = split_arguments(line.operand);
+        if(arguments.size() > definition.parameters.size()) { // too many arguments
+            this->error_flag |= 256;
+            return false;
+        }
+        arguments.resize(definition.parameters.size());
+
+        shared_ptr<vector<source_line>> expansion = make_shared<vector<source_line>>();
+        expansion->reserve(definition.body.size());
+        for(const source_line &body_line : definition.body) {
+            source_line expanded = body_line;
+            if(!body_line.comment) {
+                expanded.label = substitute(body_line.label, definition.parameters, arguments);
+                expanded.opcode = substitute(body_line.opcode, definition.parameters, arguments);
+                expanded.opcode = upper(expanded.opcode);
+                expanded.operand = substitute(body_line.operand, definition.parameters, arguments);
+                expanded.text = expanded.label + string(expanded.label.length() < 7 ? 7 - expanded.label.length() : 1, ' ')
+                    + expanded.opcode + ' ' + expanded.operand;
+            }
+            expansion->push_back(expanded);
+        }
+        lines = this->expansion_cache[key] = expansion;
+    }
+
+    this->source_stack.push_back({"", lines, 0});
+    return true;
+}
+
+bool SICAssembler::next_source_line(source_line &line) {
+    // lines of included files and macro expansions come first, innermost first
+    while(!this->source_stack.empty()) {
+        source_frame &frame = this->source_stack.back();
+        if(frame.next < frame.lines->size()) {
+            line = (*frame.lines)[frame.next++];
+            return true;
+        }
+        this->source_stack.pop_back();
+    }
+
+    if(input->eof()) return false;
+    line = parse_source_line(input->readline());
+    return true;
+}
+
+bool SICAssembler::include_source(string &operand) {
+    string path = operand;
+    if(path.length() >= 3 && toupper(path[0]) == 'C' && path[1] == '\'' && path[path.length() - 1] == '\'') {
+        path = path.substr(2, path.length() - 3);
+    } else if(path.length() >= 2 && path[0] == '\'' && path[path.length() - 1] == '\'') {
+        path = path.substr(1, path.length() - 2);
+    }
+
+    // relative paths are relative to the including file, the input itself if no file is included yet
+    if(path[0] != '/' && path[0] != '\\' && path.find(':') == string::npos) {
+        string including = this->source_path;
+        for(auto frame = this->source_stack.rbegin(); frame != this->source_stack.rend(); frame++) {
+            if(frame->path == "") continue; // macro expansion
+            including = frame->path;
+            break;
+        }
+        size_t pos = including.find_last_of("/\\");
+        if(pos != string::npos) path = including.substr(0, pos + 1) + path;
+    }
+
+    if(this->source_stack.size() >= max_include_depth) {
+        log("include nested too deep: " + path);
+        this->error_flag |= 128;
+        return false;
+    }
+
+    // the same file may be named by different paths
+    string canonical = canonical_path(path);
+    if(canonical == "") { // can't open file
+        log("can't open include file: " + path);
+        this->error_flag |= 128;
+        return false;
+    }
+    bool cycle = canonical == this->source_path;
+    for(source_frame &frame : this->source_stack) cycle |= frame.path == canonical;
+    if(cycle) { // include cycle
+        log("include cycle: " + path);
+        this->error_flag |= 128;
+        return false;
+    }
+    path = canonical;
+
+    shared_ptr<const vector<source_line>> lines = load_source_file(path);
+    if(lines == nullptr) { // can't open file
+        log("can't open include file: " + path);
+        this->error_flag |= 128;
+        return false;
+    }
+    this->source_stack.push_back({path, lines, 0});
+    return true;
+}
+
 bool SICAssembler::pass2() {
     int line_number, address;
-    string line, opcode, operand, label, object_code, h_record, e_record, tmp_s;
+    string line, opcode, operand, label, h_record, e_record, tmp_s;
+    vector<unsigned char> object_code;
     text_record t_record;
     instruction processed_instruction;
-    bool first_line = true;
+    bool first_line = true, relocated;
 
     // restart intermediate file
     this->intermediate->seekp(0, ios::beg);
     this->error_flag = 0;
+    this->modification_records.clear();
+    object_code.reserve(max_text_record_length);
     while(true) {
         if(intermediate->eof()) { // empty file
             this->error_flag |= 64 | 1;
@@ -196,7 +659,7 @@ bool SICAssembler::pass2() {
 
             h_record = "H" + sep() + label + '\t' + sep() + align_right(operand, 6, '0') + sep() + align_right(itos(this->program_length, 16), 6, '0') + '\n';
             this->output_object->write(h_record);
-            this->write_listing_line(line, object_code);
+            this->write_listing_line(line, opcode, address, object_code);
         } else if(opcode == "END") { // empty program
             this->error_flag |= 64 | 1;
             return false;
@@ -212,9 +675,10 @@ bool SICAssembler::pass2() {
     t_record = initialize_text_record(address);
 
     if(first_line) {
-        object_code = this->toObjCode(opcode, operand);
+        this->toObjCode(opcode, operand, address, object_code, relocated);
+        if(this->relocatable && relocated) this->add_modification_record(opcode, address);
         this->process_text_record(t_record, address, object_code);
-        this->write_listing_line(line, object_code);
+        this->write_listing_line(line, opcode, address, object_code);
         if(this->error_flag) return false;
     }
 
@@ -223,19 +687,24 @@ bool SICAssembler::pass2() {
         if(!this->intermediate_is_comment(line)) {
             if(parse_intermediate_line(line, line_number, address, label, opcode, operand)){
                 if(opcode == "END"){
-                    object_code = "";
+                    object_code.clear();
                     if(t_record.length > 0) {
                         this->write_text_record(t_record);
                     }
-                    this->write_listing_line(line, object_code);
+                    for(modification_record &m_record : this->modification_records) {
+                        this->write_modification_record(m_record);
+                    }
+                    this->write_listing_line(line, opcode, address, object_code);
+                    if(this->analyzer != nullptr) this->analyzer->write_report(this->output_listing);
 
                     e_record = "E" + sep() + align_right(itos(this->start_address, 16), 6, '0') + '\n';
                     this->output_object->write(e_record);
                     return true;
                 } else {
-                    object_code = this->toObjCode(opcode, operand);
+                    this->toObjCode(opcode, operand, address, object_code, relocated);
+                    if(this->relocatable && relocated) this->add_modification_record(opcode, address);
                     this->process_text_record(t_record, address, object_code);
-                    this->write_listing_line(line, object_code);
+                    this->write_listing_line(line, opcode, address, object_code);
                     if(this->error_flag) return false;
                 }
             } else { // invalid line
@@ -252,93 +721,172 @@ bool SICAssembler::pass2() {
     return false;
 }
 
-string SICAssembler::toObjCode(string &opcode, string &operand) {
-    string objCode, tmp_s;
-    int x = 0, tmp_i;
+bool SICAssembler::toObjCode(string &opcode, string &operand, int address, vector<unsigned char> &obj_code, bool &relocated) {
+    // write the object code of one line as bytes into 'obj_code'
+    // 'relocated' is set if the address field depends on where the program is loaded
+    int x = 0, tmp_i, high, low;
+    size_t length;
+    bool resolved;
+
+    obj_code.clear();
+    relocated = false;
 
     if(opcode_table.find(opcode) != opcode_table.end()) {
-        objCode = align_right(itos(opcode_table.at(opcode), 16), 2, '0');
         if(operand == "") {
             if(format_table.at(opcode).find(0) != format_table.at(opcode).end()) {
-                objCode += "0000";
+                tmp_i = 0;
             } else { // invalid operand
                 this->error_flag |= 64 | 8;
-                return "";
+                return false;
             }
         } else {
             // if operand have ",X" suffix, then set x = 1
-            if(operand[operand.length() - 2] == ',' && operand[operand.length() - 1] == 'X') {
+            length = operand.length();
+            if(length > 2 && operand[length - 2] == ',' && operand[length - 1] == 'X') {
                 x = 1 << 15;
-                tmp_s = operand.substr(0, operand.length() - 2);
+                length -= 2;
             }
-            else tmp_s = operand;
 
-            if(symbol_table.find(tmp_s) != symbol_table.end()) {
-                objCode += align_right(itos(symbol_table.at(tmp_s) | x, 16), 4, '0');
-            } else { // can't find symbol
-                log("can't find symbol: " + tmp_s);
+            if(operand[0] == '=') {
+                string value;
+                int literal_length;
+                if(parse_literal(operand.substr(1, length - 1), value, literal_length) && literal_table.find(value) != literal_table.end()
+                    && literal_table.at(value).address >= 0) {
+                    tmp_i = literal_table.at(value).address | x;
+                    relocated = true;
+                } else { // literal was never placed in a pool
+                    this->error_flag |= 64 | 8;
+                    return false;
+                }
+            } else if(!this->evaluate(operand, length, address, tmp_i, relocated, resolved) || tmp_i < 0 || tmp_i >= (1 << 15)) {
+                // invalid operand
+                this->error_flag |= 64 | 8;
+                return false;
+            } else if(!resolved) { // can't find symbol
+                log("can't find symbol: " + operand);
                 this->error_flag |= 64 | 4;
-                return "";
+                return false;
+            } else {
+                tmp_i |= x;
             }
         }
-        
+        obj_code.push_back(opcode_table.at(opcode));
+        obj_code.push_back((tmp_i >> 8) & 0xFF);
+        obj_code.push_back(tmp_i & 0xFF);
     } else if(opcode == "BYTE") {
         if(toupper(operand[0]) == 'C') {
             for(int i = 2; i < operand.length() - 1; i++) {
-                objCode += align_right(itos(operand[i], 16), 2, '0');
+                obj_code.push_back(operand[i]);
             }
         } else if(toupper(operand[0]) == 'X') {
-            objCode = operand.substr(2, operand.length() - 3);
+            if((operand.length() - 3) % 2 != 0) { // odd number of hex digits
+                this->error_flag |= 64 | 8;
+                return false;
+            }
+            for(int i = 2; i + 1 < operand.length() - 1; i += 2) {
+                high = isdigit(operand[i]) ? operand[i] - '0' : toupper(operand[i]) - 'A' + 10;
+                low = isdigit(operand[i + 1]) ? operand[i + 1] - '0' : toupper(operand[i + 1]) - 'A' + 10;
+                if(!isxdigit(operand[i]) || !isxdigit(operand[i + 1])) { // invalid operand
+                    this->error_flag |= 64 | 8;
+                    return false;
+                }
+                obj_code.push_back((high << 4) | low);
+            }
         } else { // invalid operand
             this->error_flag |= 64 | 8;
-            return "";
+            return false;
         }
     } else if(opcode == "WORD") {
-        tmp_i = stoi(operand, 10);
+        if(!this->evaluate(operand, operand.length(), address, tmp_i, relocated, resolved)) { // invalid operand
+            this->error_flag |= 64 | 8;
+            return false;
+        } else if(!resolved) { // can't find symbol
+            log("can't find symbol: " + operand);
+            this->error_flag |= 64 | 4;
+            return false;
+        }
         if(tmp_i < 0) tmp_i += 1 << 24;
-        objCode = align_right(itos(tmp_i, 16), 6, '0');
-    } else if(opcode == "RESB" || opcode == "RESW") {
-        objCode = "";
+        obj_code.push_back((tmp_i >> 16) & 0xFF);
+        obj_code.push_back((tmp_i >> 8) & 0xFF);
+        obj_code.push_back(tmp_i & 0xFF);
+    } else if(opcode == "RESB" || opcode == "RESW" || opcode == "LTORG" || opcode == "INCLUDE" || opcode == "EQU" || opcode == "ORG") {
+        // no object code
     } else { // invalid opcode
         this->error_flag |= 64 | 16;
-        return "";
+        return false;
     }
 
-    return objCode;
+    return true;
 }
 
-void SICAssembler::process_text_record(text_record &t_record, int &address, string &obj_code) {
-    if(t_record.start_address + t_record.length < address) {
-        if(obj_code != "") {
+void SICAssembler::process_text_record(text_record &t_record, int &address, vector<unsigned char> &obj_code) {
+    // ORG may move the address either way, pass1 made sure no two lines have code at the same bytes
+    if(t_record.start_address + t_record.length != address) {
+        if(!obj_code.empty()) {
             this->write_text_record(t_record);
             t_record = initialize_text_record(address);
         } else return;
     }
 
-    string obj_code_tmp = obj_code;
+    // a record is split inside the object code only if more than one word still fits
+    size_t pos = 0, rest = obj_code.size();
     int tmp;
-    while(t_record.length * 2 + obj_code_tmp.length() > 60) {
-        tmp = 60 - t_record.length * 2;
-        if(tmp > 6) {
-            t_record.object_codes += obj_code_tmp.substr(0, tmp);
-            obj_code_tmp = obj_code_tmp.substr(tmp, obj_code_tmp.length() - tmp);
-            t_record.length += tmp / 2;
+    while(t_record.length + rest > max_text_record_length) {
+        tmp = max_text_record_length - t_record.length;
+        if(tmp > 3) {
+            copy(obj_code.begin() + pos, obj_code.begin() + pos + tmp, t_record.object_codes + t_record.length);
+            pos += tmp;
+            rest -= tmp;
+            t_record.length += tmp;
         }
         this->write_text_record(t_record);
         tmp = t_record.start_address + t_record.length;
         t_record = initialize_text_record(tmp);
     }
-    t_record.object_codes += obj_code_tmp;
-    t_record.length += obj_code_tmp.length() / 2;
+    copy(obj_code.begin() + pos, obj_code.end(), t_record.object_codes + t_record.length);
+    t_record.length += rest;
 }
 
 void SICAssembler::write_text_record(text_record &t_record) const {
     this->output_object->write("T" + sep() + align_right(itos(t_record.start_address, 16), 6, '0')
-    + sep() + align_right(itos(t_record.length, 16), 2, '0') + sep() + t_record.object_codes + '\n');
+    + sep() + align_right(itos(t_record.length, 16), 2, '0') + sep() + to_hex(t_record.object_codes, t_record.length) + '\n');
 }
 
-void SICAssembler::write_listing_line(string &intermediate_line, string &obj_code) const {
-    this->output_listing->write(intermediate_line + '\t' + align_right(obj_code, 10, ' ') + '\n');
+void SICAssembler::add_modification_record(string &opcode, int address) {
+    // SIC address fields are 4 half-bytes long, starting at the second byte of the instruction
+    // a WORD is relocated as a whole
+    if(opcode == "WORD") this->modification_records.push_back({address, 6});
+    else this->modification_records.push_back({address + 1, 4});
+}
+
+void SICAssembler::write_modification_record(modification_record &m_record) const {
+    this->output_object->write("M" + sep() + align_right(itos(m_record.address, 16), 6, '0') + sep() + align_right(itos(m_record.length, 16), 2, '0') + '\n');
+}
+
+void SICAssembler::write_listing_line(string &intermediate_line, string &opcode, int address, vector<unsigned char> &obj_code) const {
+    string annotation = "";
+    if(this->analyzer != nullptr && opcode_table.find(opcode) != opcode_table.end()) {
+        annotation = '\t' + this->analyzer->annotate(address);
+    }
+    this->output_listing->write(intermediate_line + '\t' + align_right(to_hex(obj_code.data(), obj_code.size()), 10, ' ') + annotation + '\n');
+}
+
+void SICAssembler::analyze() {
+    // pass the instructions of pass1 with their jump targets to the analyzer
+    vector<SICAnalyzer::code_line> lines;
+    int target;
+    bool relative, resolved;
+
+    lines.reserve(this->instruction_stream.size());
+    for(instruction &i : this->instruction_stream) {
+        target = -1;
+        if(i.opcode[0] == 'J' && i.operand != "" && i.operand[0] != '='
+            && (!this->evaluate(i.operand, i.operand.length(), i.address, target, relative, resolved) || !resolved)) {
+            target = -1; // indexed or not a plain address
+        }
+        lines.push_back({i.address, i.opcode, target});
+    }
+    this->analyzer->analyze(lines);
 }
 
 bool SICAssembler::assemble() {
@@ -346,6 +894,10 @@ bool SICAssembler::assemble() {
         return false;
     }
 
+    if (this->analyzer != nullptr) {
+        this->analyze();
+    }
+
     if (!pass2()) {
         return false;
     }
@@ -382,16 +934,21 @@ bool SICAssembler::parse_input_line(string line, string& label, string& opcode,
         opcode = upper(tokens[0]);
         operand = "";
     } else if(tokens.size() == 2) {
-        if(opcode_table.find(upper(tokens[0])) != opcode_table.end() || upper(tokens[0]) == "START" || upper(tokens[0]) == "END") {
+        if(opcode_table.find(upper(tokens[0])) != opcode_table.end() || directive_table.find(upper(tokens[0])) != directive_table.end()) {
             label = "";
             opcode = upper(tokens[0]);
             operand = tokens[1];
         } else {
-            if(opcode_table.find(upper(tokens[1])) != opcode_table.end() || upper(tokens[1]) == "START" || upper(tokens[1]) == "END") {
+            if(opcode_table.find(upper(tokens[1])) != opcode_table.end() || directive_table.find(upper(tokens[1])) != directive_table.end()) {
                 label = tokens[0];
                 opcode = upper(tokens[1]);
                 operand = "";
-            } else return false;
+            } else {
+                // may be a macro invocation, pass1 checks the opcode
+                label = "";
+                opcode = upper(tokens[0]);
+                operand = tokens[1];
+            }
         }
     } else {
         label = tokens[0];
@@ -407,6 +964,112 @@ bool SICAssembler::input_is_comment(string line) {
     return line[0] == '.' || line == "";
 }
 
+bool SICAssembler::parse_literal(string operand, string &value, int &length) {
+    // 'operand' is the literal without '=': C'...', X'...' or a decimal number
+    // 'value' is its object code in hex, which is also the key of the literal table
+    value = "";
+    if(operand.length() >= 3 && operand[1] == '\'' && operand[operand.length() - 1] == '\'') {
+        if(toupper(operand[0]) == 'C') {
+            for(int i = 2; i < operand.length() - 1; i++) {
+                value += align_right(itos(operand[i], 16), 2, '0');
+            }
+        } else if(toupper(operand[0]) == 'X') {
+            if(operand.length() % 2 == 0) return false;
+            for(int i = 2; i < operand.length() - 1; i++) {
+                if(!isxdigit(operand[i])) return false;
+                value += toupper(operand[i]);
+            }
+        } else return false;
+        length = value.length() / 2;
+        return length > 0;
+    }
+
+    int i = (operand[0] == '-' ? 1 : 0), n;
+    if(i >= operand.length()) return false;
+    for(; i < operand.length(); i++) {
+        if(!isdigit(operand[i])) return false;
+    }
+    n = stoi(operand, 10);
+    if(n < 0) n += 1 << 24;
+    value = align_right(itos(n, 16), 6, '0');
+    length = 3;
+    return true;
+}
+
+SICAssembler::source_line SICAssembler::parse_source_line(string text) {
+    source_line line;
+    line.text = text;
+    line.comment = input_is_comment(text);
+    line.valid = line.comment || parse_input_line(text, line.label, line.opcode, line.operand);
+    return line;
+}
+
+shared_ptr<const vector<SICAssembler::source_line>> SICAssembler::load_source_file(string path) {
+    // return the tokenized lines of 'path', or nullptr if it can't be read
+    // 'path' is the key of the cache, so it should come from canonical_path()
+    // a cached file is parsed again only if it was modified since
+    long long mtime, size;
+    if(!file_stamp(path, mtime, size)) return nullptr;
+
+    lock_guard<mutex> lock(source_cache_mutex);
+    auto it = source_cache.find(path);
+    if(it != source_cache.end() && it->second.mtime == mtime && it->second.size == size) {
+        return it->second.lines;
+    }
+
+    ifstream file(path);
+    if(!file.is_open()) return nullptr;
+    shared_ptr<vector<source_line>> lines = make_shared<vector<source_line>>();
+    string text;
+    while(getline(file, text)) {
+        lines->push_back(parse_source_line(text));
+    }
+    source_cache[path] = {mtime, size, lines};
+    return lines;
+}
+
+vector<string> SICAssembler::split_arguments(string &operand) {
+    // split a comma separated list, commas inside quotes don't count
+    vector<string> arguments;
+    string argument = "";
+    bool quoted = false;
+    for(char c : operand) {
+        if(c == '\'') quoted = !quoted;
+        if(c == ',' && !quoted) {
+            arguments.push_back(argument);
+            argument = "";
+        } else argument += c;
+    }
+    arguments.push_back(argument);
+    return arguments;
+}
+
+string SICAssembler::substitute(const string &field, const vector<string> &parameters, const vector<string> &arguments) {
+    // replace every parameter in 'field' by its argument, the longest parameter name wins
+    if(field.find('&') == string::npos) return field;
+
+    string result = "";
+    size_t best;
+    for(size_t i = 0; i < field.length(); ) {
+        best = parameters.size();
+        if(field[i] == '&') {
+            for(size_t p = 0; p < parameters.size(); p++) {
+                if(field.compare(i, parameters[p].length(), parameters[p]) == 0
+                    && (best == parameters.size() || parameters[p].length() > parameters[best].length())) {
+                    best = p;
+                }
+            }
+        }
+        if(best < parameters.size()) {
+            result += arguments[best];
+            i += parameters[best].length();
+        } else {
+            result += field[i++];
+        }
+    }
+    return result;
+}
+
 bool SICAssembler::parse_intermediate_line(string line, int &line_number, int& address, string& label, string& opcode, string& operand) {
     vector<string> tokens = split(line, "\t");
     if(tokens.size() != 5) return false;
@@ -439,7 +1102,6 @@ SICAssembler::text_record SICAssembler::initialize_text_record(int address) {
     text_record t_record;
     t_record.start_address = address;
     t_record.length = 0;
-    t_record.object_codes = "";
     return t_record;
 }
 
@@ -467,6 +1129,19 @@ void SICAssembler::setProgramLength(int program_length) {
     this->program_length = program_length;
 }
 
+void SICAssembler::setRelocatable(bool relocatable) {
+    this->relocatable = relocatable;
+}
+
+void SICAssembler::setAnalyzer(SICAnalyzer *analyzer) {
+    this->analyzer = analyzer;
+}
+
+void SICAssembler::setSourcePath(string source_path) {
+    // file the input stream reads, relative includes of the input are relative to it
+    this->source_path = (source_path == "" ? "" : canonical_path(source_path));
+}
+
 InputStream *SICAssembler::getInputStream() {
     return this->input;
 }
@@ -491,6 +1166,26 @@ int SICAssembler::getProgramLength() {
     return this->program_length;
 }
 
+bool SICAssembler::getRelocatable() {
+    return this->relocatable;
+}
+
+SICAnalyzer *SICAssembler::getAnalyzer() {
+    return this->analyzer;
+}
+
+string SICAssembler::getSourcePath() {
+    return this->source_path;
+}
+
 int SICAssembler::getErrorFlag() {
     return this->error_flag;
 }
+
+int SICAssembler::getLiteralBytesSaved() {
+    return this->literal_bytes_saved;
+}
+
+const unordered_map<string, unsigned char> &SICAssembler::getOpcodeTable() {
+    return opcode_table;
+}
@@ -1,11 +1,21 @@
+#ifndef ASSEMBLER_HPP
+#define ASSEMBLER_HPP
+
+#include<analyzer.hpp>
 #include<stream.hpp>
 #include<utility.hpp>
+#include<map>
+#include<memory>
+#include<mutex>
 #include<set>
 #include<unordered_map>
+#include<unordered_set>
 
 using namespace std;
 
 class SICAssembler {
+    static const int max_text_record_length = 30; // bytes
+
     struct instruction {
         string label;
         string opcode;
@@ -17,7 +27,51 @@ class SICAssembler {
     struct text_record {
         int start_address;
         int length;
-        string object_codes;
+        unsigned char object_codes[max_text_record_length];
+    };
+
+    struct source_line {
+        string text;
+        bool comment;
+        bool valid;     // false if the line can't be parsed
+        string label;
+        string opcode;
+        string operand;
+    };
+
+    struct source_frame {
+        string path;    // canonical path of the file the lines come from, empty for a macro expansion
+        shared_ptr<const vector<source_line>> lines;
+        size_t next;
+    };
+
+    struct cached_source {
+        long long mtime;                // in nanoseconds, an edit within the same second counts
+        long long size;
+        shared_ptr<const vector<source_line>> lines;
+    };
+
+    struct macro_definition {
+        vector<string> parameters;      // names with the leading '&', in order
+        vector<source_line> body;       // lines between MACRO and MEND
+    };
+
+    struct equate {
+        string label;
+        string operand;
+        int locctr;                     // value of '*' in the expression
+        vector<string> dependencies;    // symbols that weren't defined yet
+    };
+
+    struct modification_record {
+        int address;
+        int length;     // in half-bytes
+    };
+
+    struct literal {
+        string operand; // literal as first written, without the leading '='
+        int address;    // -1 until the literal is placed in a pool
+        int length;
     };
 
     private:
@@ -26,23 +80,58 @@ class SICAssembler {
         fstream* intermediate;
         OutputStream* output_listing;
         unordered_map<string, int> symbol_table;
+        unordered_set<string> absolute_symbols;       // EQU symbols that don't move with the program
+        vector<equate> pending_equates;               // EQUs waiting for symbols defined later
+        unordered_map<string, size_t> pending_equate_index;
+        string symbol_buffer;                         // reused by evaluate() to look up symbols
+        int max_locctr;
+        map<int, int> object_ranges;                  // start to end of the bytes that already have object code
+        unordered_map<string, literal> literal_table; // keyed by the literal's hex value
+        vector<string> literal_pool;                  // literals waiting for the next LTORG or END
+        int literal_bytes_saved;
+        string source_path;                           // canonical path of the input, empty for the console
+        vector<source_frame> source_stack;            // included files and macro expansions, innermost last
+        unordered_map<string, macro_definition> macro_table;
+        unordered_map<string, shared_ptr<const vector<source_line>>> expansion_cache; // keyed by macro name and arguments
         int start_address;
         int program_length;
         int error_flag;
+        bool relocatable;                             // emit M records for label-derived addresses
+        vector<modification_record> modification_records;
+        SICAnalyzer *analyzer;                        // static performance analysis, nullptr if disabled
+        vector<instruction> instruction_stream;       // instructions of pass1 for the analyzer
 
         void write_comment(int &line_number, string &comment) const;
         // pass 1
+        bool next_source_line(source_line &line);
+        bool include_source(string &operand);
+        bool process_source_line(source_line &line, int &locctr, int &line_number);
+        bool define_macro(source_line &line, int &line_number);
+        bool expand_macro(source_line &line, int &locctr);
         instruction process_instruction(int &locctr, string &label, string &opcode, string &operand);
         void write_intermediate_line(int &line_number, instruction &processed_instruction) const;
+        bool claim_object_code(int address, int length);
+        void define_equate(string &label, string &operand, int locctr);
+        bool resolve_equates();
+        bool evaluate(const string &expression, size_t length, int locctr, int &value, bool &relative, bool &resolved, vector<string> *unresolved = nullptr);
+        bool register_literal(string &operand);
+        void write_literal_pool(int &locctr);
         // pass 2
-        string toObjCode(string &opcode, string &operand);
-        void process_text_record(text_record& t_record, int &address, string &obj_code);
+        bool toObjCode(string &opcode, string &operand, int address, vector<unsigned char> &obj_code, bool &relocated);
+        void process_text_record(text_record& t_record, int &address, vector<unsigned char> &obj_code);
         void write_text_record(text_record& t_record) const;
-        void write_listing_line(string &intermediate_line, string &obj_code) const;
+        void add_modification_record(string &opcode, int address);
+        void write_modification_record(modification_record &m_record) const;
+        void write_listing_line(string &intermediate_line, string &opcode, int address, vector<unsigned char> &obj_code) const;
+        void analyze();
 
         static OutputStream *fake_output_stream;
         static const unordered_map<string, unsigned char> opcode_table;
         static const unordered_map<string, set<unsigned char>> format_table;
+        static const set<string> directive_table;
+        static unordered_map<string, cached_source> source_cache;
+        static mutex source_cache_mutex;
+        static const int max_include_depth = 32;    // included files and macro expansions together
 
     public:
         SICAssembler(InputStream* input, OutputStream* output_object, fstream* intermediate, OutputStream* output_listing = fake_output_stream);
@@ -56,6 +145,9 @@ class SICAssembler {
         void setOutputListingStream(OutputStream* output_listing);
         void setSymbolTable(unordered_map<string, int> symbol_table);
         void setProgramLength(int program_length);
+        void setRelocatable(bool relocatable);
+        void setAnalyzer(SICAnalyzer* analyzer);
+        void setSourcePath(string source_path);
 
         InputStream* getInputStream();
         OutputStream* getOutputObjectStream();
@@ -63,13 +155,25 @@ class SICAssembler {
         OutputStream* getOutputListingStream();
         unordered_map<string, int> getSymbolTable();
         int getProgramLength();
+        bool getRelocatable();
+        SICAnalyzer* getAnalyzer();
+        string getSourcePath();
         int getErrorFlag();
+        int getLiteralBytesSaved();
+        static const unordered_map<string, unsigned char> &getOpcodeTable();
 
         // pass 1
         static bool parse_input_line(string line, string& label, string& opcode, string& operand);
         static bool input_is_comment(string line);
+        static bool parse_literal(string operand, string &value, int &length);
+        static source_line parse_source_line(string text);
+        static shared_ptr<const vector<source_line>> load_source_file(string path);
+        static vector<string> split_arguments(string &operand);
+        static string substitute(const string &field, const vector<string> &parameters, const vector<string> &arguments);
         // pass 2
         static bool parse_intermediate_line(string line, int &line_number, int& address, string& label, string& opcode, string& operand);
         static bool intermediate_is_comment(string line);
         static text_record initialize_text_record(int address);
-};
\ No newline at end of file
+};
+
+#endif
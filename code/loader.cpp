@@ -0,0 +1,381 @@
+#include "loader.hpp"
+#include<atomic>
+#include<cstring>
+#include<thread>
+
+// value of every hex digit, -1 for any other character
+static const struct hex_table {
+    signed char value[256];
+    hex_table() {
+        for(int i = 0; i < 256; i++) value[i] = -1;
+        for(int i = 0; i < 10; i++) value['0' + i] = i;
+        for(int i = 0; i < 6; i++) value['A' + i] = value['a' + i] = 10 + i;
+    }
+} hex_digits;
+
+static const char hex_chars[] = "0123456789ABCDEF";
+
+SICLoader::SICLoader() {
+    this->program_name = "";
+    this->start_address = 0;
+    this->program_length = 0;
+    this->execution_address = 0;
+    this->load_address = 0;
+    this->error_flag = 0;
+}
+
+bool SICLoader::load(InputStream *input) {
+    string data;
+    while(!input->eof()) {
+        data += input->readline() + '\n';
+    }
+    return this->load(data.c_str(), data.length());
+}
+
+bool SICLoader::load_file(string filename) {
+    MappedFile file(filename);
+    if(!file.is_open()) { // can't open file
+        this->error_flag = 1;
+        return false;
+    }
+    return this->load(file.getData(), file.getSize());
+}
+
+bool SICLoader::load(const char *data, size_t size) {
+    // read the H, T, M and E records of an object program into memory
+    // the image stays at the address it was assembled at until relocate() is called
+    this->memory.clear();
+    this->loaded.clear();
+    this->error_flag = 0;
+    return this->read_records(data, size, false);
+}
+
+bool SICLoader::apply(const char *data, size_t size) {
+    // patch the loaded image with a delta written by make_delta()
+    // the image must not be relocated yet
+    if(this->load_address != this->start_address) {
+        this->error_flag |= 8;
+        return false;
+    }
+    this->error_flag = 0;
+    return this->read_records(data, size, true);
+}
+
+bool SICLoader::apply_file(string filename) {
+    MappedFile file(filename);
+    if(!file.is_open()) { // can't open file
+        this->error_flag = 1;
+        return false;
+    }
+    return this->apply(file.getData(), file.getSize());
+}
+
+bool SICLoader::read_records(const char *data, size_t size, bool patch) {
+    // a patch may overwrite bytes, its M records replace the ones loaded before
+    const char *p = data, *end = data + size, *eol;
+    size_t length;
+    bool header = false;
+
+    this->modification_records.clear();
+    for(; p < end; p = eol + 1) {
+        eol = (const char*)memchr(p, '\n', end - p);
+        if(eol == nullptr) eol = end;
+        length = eol - p;
+        if(length > 0 && p[length - 1] == '\r') length--;
+        if(length == 0) continue;
+
+        if(!header) {
+            if(p[0] != 'H' || !this->read_header_record(p, length, patch)) { // missing H record
+                this->error_flag |= 1;
+                return false;
+            }
+            header = true;
+        } else if(p[0] == 'T') {
+            if(!this->read_text_record(p, length, patch)) return false;
+        } else if(p[0] == 'M') {
+            if(!this->read_modification_record(p, length)) return false;
+        } else if(p[0] == 'E') {
+            if(!this->read_end_record(p, length)) return false;
+            // nothing but blank lines may follow the E record
+            for(p = eol; p < end; p++) {
+                if(*p != '\n' && *p != '\r') {
+                    this->error_flag |= 2;
+                    return false;
+                }
+            }
+            return true;
+        } else { // invalid record
+            this->error_flag |= 2;
+            return false;
+        }
+    }
+
+    // no E record
+    this->error_flag |= 32;
+    return false;
+}
+
+bool SICLoader::read_header_record(const char *record, size_t length, bool patch) {
+    // H, program name, a tab, starting address and program length
+    // a patch keeps the image and only changes its length, unless the program moved to
+    // another address: make_delta() then sends the whole program, which replaces the image
+    const char *tab = (const char*)memchr(record, '\t', length);
+    size_t pos = (tab == nullptr ? 7 : tab - record + 1); // without a tab the name is padded to 6 characters
+    int start_address, program_length;
+    bool replace;
+
+    if(length != pos + 12
+        || !read_hex(record + pos, 6, start_address)
+        || !read_hex(record + pos + 6, 6, program_length)) {
+        this->error_flag |= 2;
+        return false;
+    }
+    replace = !patch || start_address != this->start_address;
+    this->program_name = dealign_left(string(record + 1, (tab == nullptr ? pos : pos - 1) - 1), ' ');
+    this->start_address = start_address;
+    this->program_length = program_length;
+    this->execution_address = this->load_address = this->start_address;
+    if(replace) {
+        this->memory.assign(this->program_length, 0);
+        this->loaded.assign(this->program_length, 0);
+    } else {
+        this->memory.resize(this->program_length, 0);
+        this->loaded.resize(this->program_length, 0);
+    }
+    return true;
+}
+
+bool SICLoader::read_text_record(const char *record, size_t length, bool patch) {
+    // T, starting address, length and object codes
+    int address, bytes, offset, high, low;
+    if(length < 9 || !read_hex(record + 1, 6, address) || !read_hex(record + 7, 2, bytes)
+        || length != 9 + (size_t)bytes * 2) {
+        this->error_flag |= 2;
+        return false;
+    }
+    if(address < this->start_address || address + bytes > this->start_address + this->program_length) {
+        // record outside of the program
+        this->error_flag |= 8;
+        return false;
+    }
+
+    offset = address - this->start_address;
+    record += 9;
+    for(int i = 0; i < bytes; i++, record += 2) {
+        high = hex_digits.value[(unsigned char)record[0]];
+        low = hex_digits.value[(unsigned char)record[1]];
+        if((high | low) < 0) {
+            this->error_flag |= 2;
+            return false;
+        }
+        if(this->loaded[offset + i] && !patch) { // overlaps an earlier record
+            this->error_flag |= 4;
+            return false;
+        }
+        this->memory[offset + i] = (high << 4) | low;
+        this->loaded[offset + i] = 1;
+    }
+    return true;
+}
+
+bool SICLoader::read_modification_record(const char *record, size_t length) {
+    // M, address of the field and its length in half-bytes
+    modification_record m_record;
+    if(length != 9 || !read_hex(record + 1, 6, m_record.address) || !read_hex(record + 7, 2, m_record.length)
+        || m_record.length == 0 || m_record.length > 8) {
+        this->error_flag |= 2;
+        return false;
+    }
+    if(m_record.address < this->start_address
+        || m_record.address + (m_record.length + 1) / 2 > this->start_address + this->program_length) {
+        // field outside of the program
+        this->error_flag |= 8;
+        return false;
+    }
+    this->modification_records.push_back(m_record);
+    return true;
+}
+
+bool SICLoader::read_end_record(const char *record, size_t length) {
+    if(length == 1) {
+        this->execution_address = this->start_address;
+    } else if(length != 7 || !read_hex(record + 1, 6, this->execution_address)) {
+        this->error_flag |= 2;
+        return false;
+    }
+    return true;
+}
+
+bool SICLoader::relocate(int load_address) {
+    // add the distance between the new and the current load address to every field of an M record
+    // a 4 half-byte field is a SIC address: 15 bits under the index flag, which must not change
+    int delta = load_address - this->load_address, bytes, value, mask;
+    unsigned char *field;
+
+    if(load_address < 0 || load_address + this->program_length > 0x8000) { // out of memory
+        this->error_flag |= 8;
+        return false;
+    }
+
+    // check every address field first, so a failed relocation leaves the image as it was
+    for(modification_record &m_record : this->modification_records) {
+        if(m_record.length != 4) continue;
+        field = &this->memory[m_record.address - this->start_address];
+        value = (((field[0] << 8) | field[1]) & 0x7FFF) + delta;
+        if(value < 0 || value > 0x7FFF) { // address out of memory
+            this->error_flag |= 8;
+            return false;
+        }
+    }
+
+    for(modification_record &m_record : this->modification_records) {
+        // an odd length starts at the low half of the first byte
+        bytes = (m_record.length + 1) / 2;
+        field = &this->memory[m_record.address - this->start_address];
+        value = 0;
+        for(int i = 0; i < bytes; i++) value = (value << 8) | field[i];
+
+        if(m_record.length == 4) mask = 0x7FFF;
+        else mask = (m_record.length == 8 ? -1 : (1 << (m_record.length * 4)) - 1);
+        value = (value & ~mask) | ((value + delta) & mask);
+        for(int i = bytes - 1; i >= 0; i--) {
+            field[i] = value & 0xFF;
+            value >>= 8;
+        }
+    }
+
+    this->execution_address += delta;
+    this->load_address = load_address;
+    return true;
+}
+
+void SICLoader::write_hex_dump(OutputStream *output) const {
+    // 16 bytes per line, prefixed with the address of the first one
+    string dump;
+    int address;
+    dump.reserve(this->memory.size() / 16 * 48 + 48);
+    for(size_t i = 0; i < this->memory.size(); i += 16) {
+        address = this->load_address + i;
+        for(int shift = 20; shift >= 0; shift -= 4) dump += hex_chars[(address >> shift) & 0xF];
+        dump += ' ';
+        for(size_t j = i; j < i + 16 && j < this->memory.size(); j++) {
+            if(j % 4 == 0) dump += ' ';
+            dump += hex_chars[this->memory[j] >> 4];
+            dump += hex_chars[this->memory[j] & 0xF];
+        }
+        dump += '\n';
+    }
+    output->write(dump);
+}
+
+void SICLoader::write_binary(OutputStream *output) const {
+    output->write(string(this->memory.begin(), this->memory.end()));
+}
+
+string SICLoader::make_delta(SICLoader &previous, SICLoader &current) {
+    // T records for the bytes of 'current' that differ from 'previous' or are new
+    // bytes 'previous' loaded and 'current' doesn't are sent as zeros, as a fresh load leaves them
+    // both images are compared at the addresses they were assembled at, a program
+    // that moved must be compared against an empty 'previous' to send all of it
+    string delta, record;
+    int address, end, next, bytes, offset;
+    auto changed = [&](int i) {
+        int j = current.start_address + i - previous.start_address;
+        bool before = j >= 0 && j < previous.program_length && previous.loaded[j];
+        if(!current.loaded[i]) return before && previous.memory[j] != 0;
+        return !before || previous.memory[j] != current.memory[i];
+    };
+
+    delta = "H" + current.program_name + '\t' + align_right(itos(current.start_address, 16), 6, '0')
+        + align_right(itos(current.program_length, 16), 6, '0') + '\n';
+    for(int i = 0; i < current.program_length; ) {
+        if(!changed(i)) {
+            i++;
+            continue;
+        }
+
+        // a gap of a few unchanged bytes is cheaper to resend than a new record
+        end = i + 1;
+        for(next = end; next < current.program_length && next - end <= 4 && (current.loaded[next] || changed(next)); next++) {
+            if(changed(next)) end = next + 1;
+        }
+
+        for(; i < end; i += bytes) {
+            bytes = min(30, end - i);
+            address = current.start_address + i;
+            record = "T" + align_right(itos(address, 16), 6, '0') + align_right(itos(bytes, 16), 2, '0');
+            for(offset = i; offset < i + bytes; offset++) {
+                record += hex_chars[current.memory[offset] >> 4];
+                record += hex_chars[current.memory[offset] & 0xF];
+            }
+            delta += record + '\n';
+        }
+    }
+
+    for(modification_record &m_record : current.modification_records) {
+        delta += "M" + align_right(itos(m_record.address, 16), 6, '0') + align_right(itos(m_record.length, 16), 2, '0') + '\n';
+    }
+    delta += "E" + align_right(itos(current.execution_address - current.load_address + current.start_address, 16), 6, '0') + '\n';
+    return delta;
+}
+
+int SICLoader::load_files(vector<string> &filenames, vector<SICLoader> &loaders, int threads) {
+    // load every file into the loader with the same index, spread over 'threads' threads
+    // return the number of files loaded successfully
+    atomic<size_t> next(0);
+    atomic<int> loaded_files(0);
+    vector<thread> workers;
+
+    loaders.resize(filenames.size());
+    if(threads < 1) threads = 1;
+    for(int t = 0; t < threads; t++) {
+        workers.push_back(thread([&]() {
+            for(size_t i = next++; i < filenames.size(); i = next++) {
+                if(loaders[i].load_file(filenames[i])) loaded_files++;
+            }
+        }));
+    }
+    for(thread &worker : workers) worker.join();
+
+    return loaded_files;
+}
+
+bool SICLoader::read_hex(const char *s, int length, int &value) {
+    // read 'length' hex digits starting at 's'
+    int digit;
+    value = 0;
+    for(int i = 0; i < length; i++) {
+        digit = hex_digits.value[(unsigned char)s[i]];
+        if(digit < 0) return false;
+        value = (value << 4) | digit;
+    }
+    return true;
+}
+
+string SICLoader::getProgramName() {
+    return this->program_name;
+}
+
+int SICLoader::getStartAddress() {
+    return this->start_address;
+}
+
+int SICLoader::getProgramLength() {
+    return this->program_length;
+}
+
+int SICLoader::getExecutionAddress() {
+    return this->execution_address;
+}
+
+int SICLoader::getLoadAddress() {
+    return this->load_address;
+}
+
+vector<unsigned char> SICLoader::getMemory() {
+    return this->memory;
+}
+
+int SICLoader::getErrorFlag() {
+    return this->error_flag;
+}
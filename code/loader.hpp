@@ -0,0 +1,56 @@
+#ifndef LOADER_HPP
+#define LOADER_HPP
+
+#include<stream.hpp>
+#include<utility.hpp>
+
+using namespace std;
+
+class SICLoader {
+    struct modification_record {
+        int address;
+        int length; // in half-bytes
+    };
+
+    private:
+        string program_name;
+        int start_address;      // address the program was assembled at
+        int program_length;
+        int execution_address;
+        int load_address;       // address the image is currently relocated to
+        vector<unsigned char> memory; // memory[0] is the byte at load_address
+        vector<unsigned char> loaded; // 1 for every byte of memory set by a T record
+        vector<modification_record> modification_records;
+        int error_flag;
+
+        bool read_records(const char *data, size_t size, bool patch);
+        bool read_header_record(const char *record, size_t length, bool patch);
+        bool read_text_record(const char *record, size_t length, bool patch);
+        bool read_modification_record(const char *record, size_t length);
+        bool read_end_record(const char *record, size_t length);
+
+    public:
+        SICLoader();
+        bool load(InputStream* input);
+        bool load(const char *data, size_t size);
+        bool load_file(string filename);
+        bool apply(const char *data, size_t size);
+        bool apply_file(string filename);
+        bool relocate(int load_address);
+        void write_hex_dump(OutputStream* output) const;
+        void write_binary(OutputStream* output) const;
+
+        string getProgramName();
+        int getStartAddress();
+        int getProgramLength();
+        int getExecutionAddress();
+        int getLoadAddress();
+        vector<unsigned char> getMemory();
+        int getErrorFlag();
+
+        static string make_delta(SICLoader &previous, SICLoader &current);
+        static int load_files(vector<string> &filenames, vector<SICLoader> &loaders, int threads);
+        static bool read_hex(const char *s, int length, int &value);
+};
+
+#endif
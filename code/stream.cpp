@@ -1,4 +1,14 @@
 #include "stream.hpp"
+#ifdef _WIN32
+#include<windows.h>
+#else
+#include<climits>
+#include<cstdlib>
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+#endif
 
 FileInputStream::FileInputStream(string filename) {
     file.open(filename);
@@ -14,12 +24,20 @@ bool FileInputStream::eof() {
     return file.eof();
 }
 
+bool FileInputStream::fail() {
+    return file.fail();
+}
+
+bool FileInputStream::is_open() {
+    return file.is_open();
+}
+
 FileInputStream::~FileInputStream() {
     file.close();
 }
 
-FileOutputStream::FileOutputStream(string filename) {
-    file.open(filename);
+FileOutputStream::FileOutputStream(string filename, bool binary) {
+    file.open(filename, binary ? ios_base::out | ios_base::binary : ios_base::out);
 }
 
 void FileOutputStream::write(string s) {
@@ -43,10 +61,109 @@ bool ConsoleInputStream::eof() {
     return console.eof();
 }
 
+bool ConsoleInputStream::fail() {
+    return console.fail();
+}
+
 ConsoleOutputStream::ConsoleOutputStream(ostream &console): console(console) { }
 
 void ConsoleOutputStream::write(string s) {
     console << s;
 }
 
-void NoneOutputStream::write(string s) { }
\ No newline at end of file
+void NoneOutputStream::write(string s) { }
+
+#ifdef _WIN32
+MappedFile::MappedFile(string filename): data(""), size(0), open(false), file(INVALID_HANDLE_VALUE), mapping(NULL) {
+    LARGE_INTEGER file_size;
+    file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &file_size)) return;
+    size = file_size.QuadPart;
+    open = true;
+    if(size == 0) return;
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(mapping != NULL) data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(mapping == NULL || data == NULL) {
+        data = "";
+        size = 0;
+        open = false;
+    }
+}
+
+MappedFile::~MappedFile() {
+    if(size > 0) UnmapViewOfFile(data);
+    if(mapping != NULL) CloseHandle(mapping);
+    if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
+}
+
+string canonical_path(string filename) {
+    char path[MAX_PATH];
+    DWORD length = GetFullPathNameA(filename.c_str(), MAX_PATH, path, NULL);
+    if(length == 0 || length >= MAX_PATH || GetFileAttributesA(path) == INVALID_FILE_ATTRIBUTES) return "";
+    return string(path, length);
+}
+
+bool file_stamp(string filename, long long &mtime, long long &size) {
+    // the write time counts 100 ns intervals
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if(!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &attributes)) return false;
+    mtime = (((long long)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime) * 100;
+    size = ((long long)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+    return true;
+}
+#else
+MappedFile::MappedFile(string filename): data(""), size(0), open(false) {
+    struct stat file_stat;
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd < 0) return;
+    if(fstat(fd, &file_stat) == 0) {
+        size = file_stat.st_size;
+        open = true;
+        if(size > 0) {
+            void *view = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(view != MAP_FAILED) {
+                data = (const char*)view;
+            } else {
+                size = 0;
+                open = false;
+            }
+        }
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if(size > 0) munmap((void*)data, size);
+}
+
+string canonical_path(string filename) {
+    char path[PATH_MAX];
+    if(realpath(filename.c_str(), path) == NULL) return "";
+    return path;
+}
+
+bool file_stamp(string filename, long long &mtime, long long &size) {
+    struct stat file_stat;
+    if(stat(filename.c_str(), &file_stat) != 0) return false;
+#ifdef __APPLE__
+    mtime = file_stat.st_mtimespec.tv_sec * 1000000000LL + file_stat.st_mtimespec.tv_nsec;
+#else
+    mtime = file_stat.st_mtim.tv_sec * 1000000000LL + file_stat.st_mtim.tv_nsec;
+#endif
+    size = file_stat.st_size;
+    return true;
+}
+#endif
+
+bool MappedFile::is_open() {
+    return open;
+}
+
+const char *MappedFile::getData() {
+    return data;
+}
+
+size_t MappedFile::getSize() {
+    return size;
+}
\ No newline at end of file
@@ -1,3 +1,6 @@
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
 #include<stream_interface.hpp>
 #include<fstream>
 #include<iostream>
@@ -11,6 +14,8 @@ class FileInputStream: public InputStream {
         FileInputStream(string filename);
         string readline();
         bool eof();
+        bool fail();
+        bool is_open();
         ~FileInputStream();
 };
 
@@ -18,7 +23,7 @@ class FileOutputStream: public OutputStream {
     private:
         ofstream file;
     public:
-        FileOutputStream(string filename);
+        FileOutputStream(string filename, bool binary = false);
         void write(string s);
         ~FileOutputStream();
 };
@@ -30,6 +35,7 @@ class ConsoleInputStream: public InputStream {
         ConsoleInputStream(istream &console);
         string readline();
         bool eof();
+        bool fail();
 };
 
 class ConsoleOutputStream: public OutputStream {
@@ -44,3 +50,32 @@ class NoneOutputStream: public OutputStream {
     public:
         void write(string s);
 };
+
+
+class MappedFile {
+    // read-only view of a whole file, mapped into memory
+    private:
+        const char *data;
+        size_t size;
+        bool open;
+#ifdef _WIN32
+        void *file;
+        void *mapping;
+#endif
+    public:
+        MappedFile(string filename);
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        bool is_open();
+        const char *getData();
+        size_t getSize();
+        ~MappedFile();
+};
+
+// absolute path of an existing file with links and '.' resolved, empty if there is no such file
+string canonical_path(string filename);
+
+// last modification time in nanoseconds and size of a file, false if there is no such file
+bool file_stamp(string filename, long long &mtime, long long &size);
+
+#endif
@@ -1,3 +1,6 @@
+#ifndef STREAM_INTERFACE_HPP
+#define STREAM_INTERFACE_HPP
+
 #include<string>
 
 using namespace std;
@@ -6,9 +9,14 @@ class InputStream {
     public:
         virtual string readline() = 0;
         virtual bool eof() = 0;
+        virtual bool fail() = 0;
+        virtual ~InputStream() { }
 };
 
 class OutputStream {
     public:
         virtual void write(string s) = 0;
+        virtual ~OutputStream() { }
 };
+
+#endif
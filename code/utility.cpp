@@ -101,4 +101,14 @@ string upper(string &s) {
         result += toupper(s[i]);
     }
     return result;
+}
+
+string to_hex(const unsigned char *bytes, size_t length) {
+    static const char digits[] = "0123456789ABCDEF";
+    string result(length * 2, '0');
+    for(size_t i = 0; i < length; i++) {
+        result[i * 2] = digits[bytes[i] >> 4];
+        result[i * 2 + 1] = digits[bytes[i] & 0xF];
+    }
+    return result;
 }
\ No newline at end of file
@@ -1,3 +1,6 @@
+#ifndef UTILITY_HPP
+#define UTILITY_HPP
+
 #include<iostream>
 #include<vector>
 
@@ -21,4 +24,8 @@ string dealign_left(string s, char fill = ' ');
 
 vector<string> split(string &s, string delimiter);
 
-string upper(string &s);
\ No newline at end of file
+string upper(string &s);
+
+string to_hex(const unsigned char *bytes, size_t length);
+
+#endif
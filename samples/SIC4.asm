@@ -0,0 +1,27 @@
+COPY	START	2000
+FIRST	LDX	=0
+CLOOP	TD	=X'F1'
+	JEQ	CLOOP
+	RD	=X'F1'
+	STCH	BUFFER,X
+	COMP	=C'EOF'
+	JEQ	DONE
+	TIX	=4096
+	JLT	CLOOP
+DONE	STX	LENGTH
+	LDA	=C'EOF'
+	STA	RECORD
+	J	WRITE
+	LTORG
+WRITE	LDX	=0
+WLOOP	TD	=X'05'
+	JEQ	WLOOP
+	LDCH	BUFFER,X
+	WD	=X'05'
+	TIX	LENGTH
+	JLT	WLOOP
+	RSUB
+LENGTH	RESW	1
+RECORD	RESW	1
+BUFFER	RESB	4096
+	END	FIRST
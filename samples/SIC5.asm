@@ -0,0 +1,27 @@
+.relocatable sample, assembled with -r
+SUM	START	0
+COUNT	EQU	10
+TABLEN	EQU	TABEND-TABLE
+FIRST	LDA	ZERO
+	STA	TOTAL
+	LDX	ZERO
+LOOP	LDA	TOTAL
+	ADD	TABLE,X
+	STA	TOTAL
+	TIX	LIMIT
+	JLT	LOOP
+	LDA	TOTAL
+	COMP	=1000
+	JGT	BIG
+	RSUB
+BIG	LDA	=X'000001'
+	STA	FLAG
+	RSUB
+ZERO	WORD	0
+LIMIT	WORD	TABLEN
+PTR	WORD	TABLE+3
+TOTAL	RESW	1
+FLAG	RESW	1
+TABLE	RESW	COUNT
+TABEND	EQU	*
+	END	FIRST
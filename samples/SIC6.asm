@@ -0,0 +1,27 @@
+CLEAR	MACRO
+	LDA	ZERO
+	STA	TOTAL
+	MEND
+ADDTO	MACRO	&VALUE
+	LDA	TOTAL
+	ADD	&VALUE
+	STA	TOTAL
+	MEND
+MAIN	START	3000
+FIRST	STL	RETADR
+Reset	CLEAR
+	ADDTO	ONE
+	ADDTO	ONE
+	ADDTO	TEN
+	JSUB	CLEAR
+	ADDTO	ONE
+	JSUB	WRITE
+	LDL	RETADR
+	J	Reset
+CLEAR	LDA	ZERO
+	STA	TOTAL
+	RSUB
+	INCLUDE	include/SIC6write.asm
+RETADR	RESW	1
+TOTAL	RESW	1
+	END	FIRST
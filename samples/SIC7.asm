@@ -0,0 +1,34 @@
+COPY	START	2000
+BUFSIZE	EQU	BUFEND-BUFFER
+LAST	EQU	BUFSIZE-1
+FIRST	LDX	=0
+CLOOP	TD	=X'F1'
+	JEQ	CLOOP
+	RD	=X'F1'
+	STCH	BUFFER,X
+	COMP	=C'EOF'
+	JEQ	DONE
+	TIX	MAXLEN
+	JLT	CLOOP
+DONE	STX	LENGTH
+	LDA	=C'EOF'
+	STA	RECORD+1
+	J	WRITE
+	LTORG
+WRITE	LDX	=0
+WLOOP	TD	=X'05'
+	JEQ	WLOOP
+	LDCH	BUFFER,X
+	WD	=X'05'
+	TIX	LENGTH
+	JLT	WLOOP
+	RSUB
+LENGTH	RESW	1
+BUFFER	RESB	4096
+BUFEND	EQU	*
+	ORG	BUFFER
+RECORD	RESB	1
+TAG	RESW	1
+	ORG
+MAXLEN	WORD	LAST
+	END	FIRST
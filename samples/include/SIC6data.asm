@@ -0,0 +1,5 @@
+.constants shared by the routines
+ZERO	WORD	0
+ONE	WORD	1
+TEN	WORD	10
+OUTDEV	BYTE	X'05'
@@ -0,0 +1,7 @@
+.write the low byte of TOTAL to device 05
+WRITE	TD	OUTDEV
+	JEQ	WRITE
+	LDCH	TOTAL+2
+	WD	OUTDEV
+	RSUB
+	INCLUDE	SIC6data.asm